@@ -9,6 +9,11 @@
 
 #include <uapi/drm/ane_accel.h>
 
+struct ane_lock_stat {
+	atomic64_t contended;
+	atomic64_t wait_ns;
+};
+
 struct ane_device {
 	struct drm_device drm;
 	struct device *dev;
@@ -32,6 +37,9 @@ struct ane_device {
 
 	struct mutex iommu_lock;
 	struct mutex engine_lock;
+
+	struct ane_lock_stat iommu_stat;
+	struct ane_lock_stat engine_stat;
 };
 
 struct ane_hw {
@@ -52,6 +60,7 @@ struct ane_request {
 	u32 td_count;
 	u32 btsp_iova;
 	u32 bar[ANE_TILE_COUNT];
+	u64 exec_ns;
 };
 
 #endif /* __ANE_H__ */
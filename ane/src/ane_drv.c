@@ -3,6 +3,7 @@
 
 #include <linux/interrupt.h>
 #include <linux/iommu.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/of_device.h>
 #include <linux/platform_device.h>
@@ -38,9 +39,23 @@ static struct ane_bo *bo_lookup(struct drm_file *file, u32 handle)
 	return to_bo(gem);
 }
 
+/* Counts lock contention for the engine_lock/iommu_lock sysfs attributes */
+static void ane_mutex_lock(struct mutex *lock, struct ane_lock_stat *stat)
+{
+	u64 start;
+
+	if (mutex_trylock(lock))
+		return;
+
+	start = ktime_get_ns();
+	mutex_lock(lock);
+	atomic64_inc(&stat->contended);
+	atomic64_add(ktime_get_ns() - start, &stat->wait_ns);
+}
+
 static void ane_iommu_invalidate_tlb(struct ane_device *ane)
 {
-	mutex_lock(&ane->iommu_lock);
+	ane_mutex_lock(&ane->iommu_lock, &ane->iommu_stat);
 
 	iommu_flush_iotlb_all(ane->domain);
 
@@ -63,7 +78,7 @@ static int ane_iommu_map_pages(struct ane_device *ane, struct ane_bo *bo)
 	if (!bo->mm)
 		return -ENOMEM;
 
-	mutex_lock(&ane->iommu_lock);
+	ane_mutex_lock(&ane->iommu_lock, &ane->iommu_stat);
 
 	/* reserve area from ANE address space */
 	err = drm_mm_insert_node_generic(&ane->mm, bo->mm,
@@ -110,7 +125,7 @@ static void ane_iommu_unmap_pages(struct ane_device *ane, struct ane_bo *bo)
 	if (!bo->mm)
 		return;
 
-	mutex_lock(&ane->iommu_lock);
+	ane_mutex_lock(&ane->iommu_lock, &ane->iommu_stat);
 	for (u32 i = 0; i < bo->npages; i++) {
 		dma_addr_t iova = bo->iova + (i << ane->shift);
 		iommu_unmap(ane->domain, iova, 1UL << ane->shift);
@@ -269,7 +284,7 @@ static int ane_submit(struct drm_device *drm, void *data, struct drm_file *file)
 		return -EINVAL;
 	req.btsp_iova = lower_32_bits(bo->iova);
 
-	mutex_lock(&ane->engine_lock);
+	ane_mutex_lock(&ane->engine_lock, &ane->engine_stat);
 
 	err = ane_tm_enqueue(ane, &req);
 	if (err < 0)
@@ -279,6 +294,8 @@ static int ane_submit(struct drm_device *drm, void *data, struct drm_file *file)
 	if (err < 0)
 		goto unlock;
 
+	args->exec_ns = req.exec_ns;
+
 unlock:
 	mutex_unlock(&ane->engine_lock);
 	return err;
@@ -621,6 +638,35 @@ static int __maybe_unused ane_runtime_resume(struct device *dev)
 	return 0;
 }
 
+static ssize_t engine_lock_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct ane_device *ane = dev_get_drvdata(dev);
+	return sysfs_emit(buf, "%lld %lld\n",
+			  atomic64_read(&ane->engine_stat.contended),
+			  atomic64_read(&ane->engine_stat.wait_ns));
+}
+
+static ssize_t iommu_lock_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct ane_device *ane = dev_get_drvdata(dev);
+	return sysfs_emit(buf, "%lld %lld\n",
+			  atomic64_read(&ane->iommu_stat.contended),
+			  atomic64_read(&ane->iommu_stat.wait_ns));
+}
+
+/* "<contended count> <total wait ns>" */
+static DEVICE_ATTR_RO(engine_lock);
+static DEVICE_ATTR_RO(iommu_lock);
+
+static struct attribute *ane_attrs[] = {
+	&dev_attr_engine_lock.attr,
+	&dev_attr_iommu_lock.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(ane);
+
 // clang-format off
 static const struct dev_pm_ops ane_pm_ops = {
 	SET_RUNTIME_PM_OPS(ane_runtime_suspend, ane_runtime_resume, NULL)
@@ -660,6 +706,7 @@ static struct platform_driver ane_platform_driver = {
 	{
 	    .name	    = "ane",
 	    .pm             = pm_ptr(&ane_pm_ops),
+	    .dev_groups     = ane_groups,
 	    .of_match_table = ane_of_match,
 	},
 };
@@ -2,6 +2,7 @@
 /* Copyright 2022 Eileen Yoon <eyn@gmx.com> */
 
 #include <linux/iopoll.h>
+#include <linux/ktime.h>
 
 #include "ane_tm.h"
 
@@ -131,10 +132,13 @@ static void ane_tm_handle_irq(struct ane_device *ane)
 int ane_tm_execute(struct ane_device *ane, struct ane_request *req)
 {
 	int err;
+	u64 start;
 
+	start = ktime_get_ns();
 	ane_tm_push_tq(ane, req);
 
 	err = ane_tm_get_status(ane);
+	req->exec_ns = ktime_get_ns() - start;
 
 	ane_tm_handle_irq(ane);
 
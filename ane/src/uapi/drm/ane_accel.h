@@ -35,6 +35,7 @@ struct drm_ane_submit {
 	__u32 handles[ANE_TILE_COUNT];
 	__u32 btsp_handle;
 	__u32 pad;
+	__u64 exec_ns; /* out: time from push to idle */
 };
 
 #define DRM_IOCTL_ANE_BO_INIT \
@@ -8,6 +8,16 @@ void *pyane_init(char *path, int dev_id)
 	return __ane_init(path, dev_id);
 }
 
+void *pyane_init_async(char *path, int dev_id)
+{
+	return __ane_init_async(path, dev_id);
+}
+
+int pyane_wait(struct ane_nn *nn)
+{
+	return ane_wait(nn);
+}
+
 int pyane_free(struct ane_nn *nn)
 {
 	ane_free(nn);
@@ -33,6 +43,10 @@ int pyane_send(struct ane_nn *nn, void *x0, void *x1, void *x2, void *x3,
 				 x8,  x9,  x10, x11, x12, x13, x14, x15,
 				 x16, x17, x18, x19, x20, x21, x22, x23,
 				 x24, x25, x26, x27, x28, x29, x30, x31 };
+	int err = ane_wait(nn); /* counts are only valid once loaded */
+	if (err < 0)
+		return err;
+
 	for (uint32_t i = 0; i < ane_src_count(nn); i++) {
 		__ane_tile_send(nn, xs[i], i);
 	}
@@ -50,6 +64,10 @@ int pyane_read(struct ane_nn *nn, void *x0, void *x1, void *x2, void *x3,
 				 x8,  x9,  x10, x11, x12, x13, x14, x15,
 				 x16, x17, x18, x19, x20, x21, x22, x23,
 				 x24, x25, x26, x27, x28, x29, x30, x31 };
+	int err = ane_wait(nn); /* counts are only valid once loaded */
+	if (err < 0)
+		return err;
+
 	for (uint32_t i = 0; i < ane_dst_count(nn); i++) {
 		__ane_tile_read(nn, xs[i], i);
 	}
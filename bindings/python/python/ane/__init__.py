@@ -14,6 +14,9 @@ class _Driver:
 		self.lib = ctypes.cdll.LoadLibrary(lib_path)
 		self.lib.pyane_init.restype = c_void_p
 		self.lib.pyane_init.argtypes = [ctypes.c_char_p, ctypes.c_int]
+		self.lib.pyane_init_async.restype = c_void_p
+		self.lib.pyane_init_async.argtypes = [ctypes.c_char_p, ctypes.c_int]
+		self.lib.pyane_wait.argtypes = [c_void_p]
 		self.lib.pyane_free.argtypes = [c_void_p]
 		self.lib.pyane_exec.argtypes = [c_void_p]
 		self.lib.pyane_send.argtypes = [c_void_p] + [c_void_p] * 0x20
@@ -25,16 +28,17 @@ class _Driver:
 		for handle in self.handles:
 			self.lib.pyane_free(handle)
 
-	def register(self, path, dev_id):
-		handle = self.lib.pyane_init(path.encode('ascii'), dev_id)
+	def register(self, path, dev_id, async_load=False):
+		init = self.lib.pyane_init_async if async_load else self.lib.pyane_init
+		handle = init(path.encode('ascii'), dev_id)
 		if (handle == None): raise RuntimeError("driver error")
 		self.handles[handle] = handle
 		return handle
 
 class model:
-	def __init__(self, path, dev_id=0, lib_path="/usr/lib/libane_python.so"):
+	def __init__(self, path, dev_id=0, lib_path="/usr/lib/libane_python.so", async_load=False):
 		self.driver = _Driver(lib_path)
-		self.handle = self.driver.register(path, dev_id)
+		self.handle = self.driver.register(path, dev_id, async_load)
 		fmt = Struct("size" / Int64ul,"td_size" / Int32ul, "td_count" / Int32ul, "tsk_size" / Int64ul, "krn_size" / Int64ul, "src_count" / Int32ul, "dst_count" / Int32ul, "tiles" / Array(0x20, Int32ul), "nchw" / Array(0x20 * 6, Int64ul))
 		res = fmt.parse(open(path, "rb").read()[:fmt.sizeof()])
 		self.src_count, self.dst_count = res.src_count, res.dst_count
@@ -42,10 +46,13 @@ class model:
 		self.outputs = [ctypes.create_string_buffer(nchw[0]*nchw[1]*nchw[2]*nchw[3]*2) for nchw in self.dst_nchw]
 		self.inputs_pad, self.outputs_pad = [b''] * (0x20 - res.src_count), [b''] * (0x20 - res.dst_count)
 
+	def wait(self):  # block until an async load settles; predict() waits on its own
+		if (self.driver.lib.pyane_wait(self.handle) < 0): raise RuntimeError("driver error")
+
 	def predict(self, inarrs):  # list of numpy arrays
 		assert(len(inarrs) == self.src_count)
 		assert(all(((arr.dtype == np.float16) and (arr.shape == self.src_nchw[idx][:4])) for idx,arr in enumerate(inarrs)))
-		self.driver.lib.pyane_send(self.handle, *[arr.tobytes(order='C') for arr in inarrs], *self.inputs_pad)
+		if (self.driver.lib.pyane_send(self.handle, *[arr.tobytes(order='C') for arr in inarrs], *self.inputs_pad) < 0): raise RuntimeError("driver error")
 		self.driver.lib.pyane_exec(self.handle)
-		self.driver.lib.pyane_read(self.handle, *self.outputs, *self.outputs_pad)
+		if (self.driver.lib.pyane_read(self.handle, *self.outputs, *self.outputs_pad) < 0): raise RuntimeError("driver error")
 		return [np.frombuffer(self.outputs[idx], dtype=np.float16).reshape(*self.dst_nchw[idx][:4]) for idx in range(self.dst_count)]
@@ -5,18 +5,20 @@
 #include <drm.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <ane_accel.h>
 #include "ane.h"
 
 #ifndef LIBANE_CONFIG_NO_ERR
-#include <stdio.h>
 #define ane_err(a, ...) fprintf(stderr, "LIBANE: ERR: " a, ##__VA_ARGS__)
 #else
 #define ane_err(...) \
@@ -416,6 +418,29 @@ static inline void ane_model_free(struct ane_nn *nn)
 	free(nn->data);
 }
 
+static int ane_nn_load(struct ane_nn *nn, const char *path, int dev_id)
+{
+	if (ane_model_init(nn, path) < 0) {
+		ane_err("failed to load anec from %s\n", path);
+		return -EINVAL;
+	}
+
+	if (ane_device_open(nn, dev_id) < 0) {
+		ane_err("failed to open device with dev_id %d\n", dev_id);
+		ane_model_free(nn);
+		return -ENODEV;
+	}
+
+	if (ane_chan_init(nn) < 0) {
+		ane_err("failed to init memory-mapped chans\n");
+		ane_device_close(nn);
+		ane_model_free(nn);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
 struct ane_nn *__ane_init(const char *path, int dev_id)
 {
 	struct ane_nn *nn = ane_zmalloc(sizeof(struct ane_nn));
@@ -423,23 +448,248 @@ struct ane_nn *__ane_init(const char *path, int dev_id)
 		return NULL;
 	}
 
-	if (ane_model_init(nn, path) < 0) {
-		ane_err("failed to load anec from %s\n", path);
+	if (ane_nn_load(nn, path, dev_id) < 0) {
 		free(nn);
 		return NULL;
 	}
 
-	if (ane_device_open(nn, dev_id) < 0) {
-		ane_err("failed to open device with dev_id %d\n", dev_id);
-		ane_model_free(nn);
+	return nn;
+}
+
+/*
+ * Background loading. Loads are queued onto a small pool of detached worker
+ * threads spawned on first use. The handle is returned immediately; every
+ * entry point touching the device or the mapped channels waits for the load
+ * to settle first.
+ */
+
+#ifndef LIBANE_CONFIG_LOAD_WORKERS
+#define LIBANE_CONFIG_LOAD_WORKERS 8
+#endif /* LIBANE_CONFIG_LOAD_WORKERS */
+
+struct ane_load {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int done;
+	int err;
+	char *path;
+	int dev_id;
+	struct ane_nn *nn;
+	struct ane_load *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct ane_load *head;
+	struct ane_load *tail;
+	int workers;
+	struct ane_load *running[LIBANE_CONFIG_LOAD_WORKERS]; /* per worker */
+} load_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_once_t load_pool_once = PTHREAD_ONCE_INIT;
+
+static void *ane_load_worker(void *arg)
+{
+	const int slot = (int)(intptr_t)arg;
+	struct ane_load *load;
+	int err;
+
+	for (;;) {
+		pthread_mutex_lock(&load_pool.lock);
+		while (!load_pool.head)
+			pthread_cond_wait(&load_pool.cond, &load_pool.lock);
+		load = load_pool.head;
+		load_pool.head = load->next;
+		if (!load_pool.head)
+			load_pool.tail = NULL;
+		load_pool.running[slot] = load;
+		pthread_mutex_unlock(&load_pool.lock);
+
+		err = ane_nn_load(load->nn, load->path, load->dev_id);
+
+		/*
+		 * Retire the slot and publish under load_pool.lock so a fork
+		 * never sees a published load in running[], nor a running
+		 * load whose lock this thread holds.
+		 */
+		pthread_mutex_lock(&load_pool.lock);
+		load_pool.running[slot] = NULL;
+		pthread_mutex_lock(&load->lock);
+		load->err = err;
+		__atomic_store_n(&load->done, 1, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&load->cond);
+		pthread_mutex_unlock(&load->lock);
+		pthread_mutex_unlock(&load_pool.lock);
+	}
+
+	return NULL;
+}
+
+/* Called with load_pool.lock held */
+static inline int ane_load_spawn(void)
+{
+	pthread_t thread;
+	const int slot = load_pool.workers;
+
+	if (pthread_create(&thread, NULL, ane_load_worker,
+			   (void *)(intptr_t)slot))
+		return -EAGAIN;
+
+	pthread_detach(thread);
+	load_pool.workers++;
+
+	return 0;
+}
+
+static void ane_load_fork_prepare(void)
+{
+	pthread_mutex_lock(&load_pool.lock);
+}
+
+static void ane_load_fork_parent(void)
+{
+	pthread_mutex_unlock(&load_pool.lock);
+}
+
+/*
+ * Only the forking thread survives in the child. Queued loads stay queued
+ * and get fresh workers on the next submit or wait; loads a worker was in
+ * the middle of are half done and fail with -ECHILD. Whatever such a load
+ * had set up (model copy, fd, channel mappings) is leaked in the child:
+ * the worker may have been anywhere inside ane_nn_load(), and the BO
+ * handles belong to the file the parent still uses, so freeing them here
+ * would pull them from under the parent.
+ */
+static void ane_load_fork_child(void)
+{
+	struct ane_load *load;
+
+	pthread_mutex_init(&load_pool.lock, NULL);
+	pthread_cond_init(&load_pool.cond, NULL);
+
+	/* entries in running[] are never published; see ane_load_worker() */
+	for (int slot = 0; slot < load_pool.workers; slot++) {
+		load = load_pool.running[slot];
+		load_pool.running[slot] = NULL;
+		if (!load)
+			continue;
+		pthread_mutex_init(&load->lock, NULL);
+		pthread_cond_init(&load->cond, NULL);
+		load->err = -ECHILD;
+		load->done = 1;
+	}
+
+	load_pool.workers = 0;
+}
+
+static void ane_load_pool_init(void)
+{
+	pthread_atfork(ane_load_fork_prepare, ane_load_fork_parent,
+		       ane_load_fork_child);
+}
+
+/* Make sure queued loads have someone to run them */
+static inline int ane_load_kick(void)
+{
+	int err = 0;
+
+	pthread_once(&load_pool_once, ane_load_pool_init);
+
+	pthread_mutex_lock(&load_pool.lock);
+
+	/* grow the pool lazily; a spawn failure is fine if any worker exists */
+	if (load_pool.head && load_pool.workers < LIBANE_CONFIG_LOAD_WORKERS) {
+		if (ane_load_spawn() < 0 && !load_pool.workers) {
+			ane_err("failed to spawn load worker\n");
+			err = -EAGAIN;
+		}
+	}
+
+	pthread_cond_signal(&load_pool.cond);
+	pthread_mutex_unlock(&load_pool.lock);
+
+	return err;
+}
+
+static inline int ane_load_submit(struct ane_load *load)
+{
+	struct ane_load **prev;
+	int err;
+
+	pthread_once(&load_pool_once, ane_load_pool_init);
+
+	pthread_mutex_lock(&load_pool.lock);
+	if (load_pool.tail)
+		load_pool.tail->next = load;
+	else
+		load_pool.head = load;
+	load_pool.tail = load;
+	pthread_mutex_unlock(&load_pool.lock);
+
+	err = ane_load_kick();
+	if (err < 0) {
+		/* nobody will ever run it; take it back off the queue */
+		pthread_mutex_lock(&load_pool.lock);
+		load_pool.tail = NULL;
+		prev = &load_pool.head;
+		while (*prev) {
+			if (*prev == load) {
+				*prev = load->next;
+				continue;
+			}
+			load_pool.tail = *prev;
+			prev = &(*prev)->next;
+		}
+		pthread_mutex_unlock(&load_pool.lock);
+	}
+
+	return err;
+}
+
+static inline void ane_load_free(struct ane_load *load)
+{
+	pthread_mutex_destroy(&load->lock);
+	pthread_cond_destroy(&load->cond);
+	free(load->path);
+	free(load);
+}
+
+struct ane_nn *__ane_init_async(const char *path, int dev_id)
+{
+	struct ane_load *load;
+	struct ane_nn *nn;
+
+	nn = ane_zmalloc(sizeof(struct ane_nn));
+	if (!nn) {
+		return NULL;
+	}
+
+	load = ane_zmalloc(sizeof(struct ane_load));
+	if (!load) {
 		free(nn);
 		return NULL;
 	}
 
-	if (ane_chan_init(nn) < 0) {
-		ane_err("failed to init memory-mapped chans\n");
-		ane_device_close(nn);
-		ane_model_free(nn);
+	load->path = strdup(path);
+	if (!load->path) {
+		ane_err("failed to copy path %s\n", path);
+		free(load);
+		free(nn);
+		return NULL;
+	}
+
+	pthread_mutex_init(&load->lock, NULL);
+	pthread_cond_init(&load->cond, NULL);
+	load->dev_id = dev_id;
+	load->nn = nn;
+	nn->load = load;
+
+	if (ane_load_submit(load) < 0) {
+		ane_load_free(load);
 		free(nn);
 		return NULL;
 	}
@@ -447,24 +697,70 @@ struct ane_nn *__ane_init(const char *path, int dev_id)
 	return nn;
 }
 
+static inline int ane_load_settle(struct ane_load *load)
+{
+	int err;
+
+	if (!__atomic_load_n(&load->done, __ATOMIC_ACQUIRE))
+		ane_load_kick();
+
+	pthread_mutex_lock(&load->lock);
+	while (!load->done)
+		pthread_cond_wait(&load->cond, &load->lock);
+	err = load->err;
+	pthread_mutex_unlock(&load->lock);
+
+	return err;
+}
+
+int ane_wait(struct ane_nn *nn)
+{
+	struct ane_load *load = nn->load;
+
+	if (!load)
+		return 0;
+
+	if (__atomic_load_n(&load->done, __ATOMIC_ACQUIRE))
+		return load->err;
+
+	return ane_load_settle(load);
+}
+
 void __ane_free(struct ane_nn *nn)
 {
+	if (nn->load) {
+		/* take the lock so the worker is done touching the load */
+		int err = ane_load_settle(nn->load);
+		ane_load_free(nn->load);
+		if (err < 0) {
+			/*
+			 * worker already unwound everything it set up, except
+			 * for -ECHILD, whose partial state is leaked on purpose
+			 * (see ane_load_fork_child())
+			 */
+			free(nn);
+			return;
+		}
+	}
+
 	ane_chan_free(nn);
 	ane_device_close(nn);
 	ane_model_free(nn);
 	free(nn);
 }
 
-int ane_exec(struct ane_nn *nn)
+static inline int ane_submit(struct ane_nn *nn, const uint32_t td_count,
+			     const uint32_t td_size, uint64_t *exec_ns)
 {
 	const struct anec *anec = to_anec(nn);
+	int err;
 
 	struct drm_ane_submit args;
 	memset(&args, 0, sizeof(args));
 
 	args.tsk_size = anec->tsk_size;
-	args.td_count = anec->td_count;
-	args.td_size = anec->td_size;
+	args.td_count = td_count;
+	args.td_size = td_size;
 
 	for (int bdx = 0; bdx < ANE_TILE_COUNT; bdx++) {
 		if (anec->tiles[bdx]) {
@@ -473,7 +769,251 @@ int ane_exec(struct ane_nn *nn)
 	}
 	args.btsp_handle = nn->btsp_chan.handle;
 
-	return ioctl(nn->fd, DRM_IOCTL_ANE_SUBMIT, &args);
+	err = ioctl(nn->fd, DRM_IOCTL_ANE_SUBMIT, &args);
+	if (exec_ns)
+		*exec_ns = args.exec_ns;
+
+	return err;
+}
+
+int ane_exec(struct ane_nn *nn)
+{
+	int err = ane_wait(nn);
+	if (err < 0)
+		return err;
+
+	return ane_submit(nn, to_anec(nn)->td_count, to_anec(nn)->td_size,
+			  NULL);
+}
+
+static inline uint64_t ane_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static inline void bo_touch(struct ane_bo *bo, const uint64_t page)
+{
+	volatile uint8_t *map = bo->map;
+
+	if (!map)
+		return;
+
+	/* write back what's there so every page is faulted in writable */
+	for (uint64_t off = 0; off < bo->size; off += page) {
+		map[off] = map[off];
+	}
+}
+
+int ane_warmup(struct ane_nn *nn, const uint32_t iters,
+	       struct ane_warmup *stats)
+{
+	const uint64_t page = sysconf(_SC_PAGESIZE);
+	uint64_t start, warm = 0;
+	int err;
+
+	err = ane_wait(nn);
+	if (err < 0)
+		return err;
+
+	for (int bdx = 0; bdx < ANE_TILE_COUNT; bdx++) {
+		bo_touch(&nn->chans[bdx], page);
+	}
+	bo_touch(&nn->btsp_chan, page);
+
+	/*
+	 * Executions are issued back to back so the device stays resumed
+	 * (autosuspend is 1s) and the DART TLB stays populated between them.
+	 */
+	for (uint32_t i = 0; i < iters; i++) {
+		start = ane_now_ns();
+		err = ane_exec(nn);
+		if (err < 0) {
+			ane_err("warmup execution %u failed with %d\n", i, err);
+			return err;
+		}
+		if (!i) {
+			if (stats)
+				stats->cold_ns = ane_now_ns() - start;
+		} else {
+			warm += ane_now_ns() - start;
+		}
+	}
+
+	if (stats) {
+		if (!iters)
+			stats->cold_ns = 0;
+		stats->iters = iters;
+		stats->warm_ns = (iters > 1) ? warm / (iters - 1) : 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Task-level profiling. Task descriptors (td) start with a 0x28 header
+ * followed by register streams, each a [count:8][address:24] code word and
+ * (count / 4) + 1 register values. Header fields follow tinygrad's naming:
+ * ExeCycles is the compiler's cycle estimate, NextSize the size of the next
+ * td (in words, minus one, as programmed into TQ_SIZE1) and NextPointer its
+ * command offset. The first td's size is anec->td_size.
+ */
+
+#define TD_HDR_SIZE	   0x28
+#define TD_HDR_CYCLES	   0x4
+#define TD_HDR_NEXT_SIZE   0x4
+#define TD_HDR_NEXT	   0x20
+
+#define td_cycles(hdr1)	   ((hdr1) & 0xffff)
+#define td_next_size(hdr1) (((((hdr1) >> 16) & 0x1ff) + 1) << 2)
+
+#define stream_count(code) ((((code) >> 24) >> 2) + 1)
+#define stream_addr(code)  ((code) & 0xffffff)
+
+static const struct {
+	const char *name;
+	uint32_t addr;
+} td_streams[ANE_STREAM_COUNT] = {
+	[ANE_STREAM_KERNEL] = { "kernel", 0x1f800 },
+	[ANE_STREAM_COMMON] = { "common", 0x00000 },
+	[ANE_STREAM_SRC] = { "src", 0x13800 },
+	[ANE_STREAM_L2] = { "l2", 0x04800 },
+	[ANE_STREAM_PLANAR] = { "planar", 0x08800 },
+	[ANE_STREAM_NEURAL] = { "neural", 0x0c800 },
+	[ANE_STREAM_DST] = { "dst", 0x17800 },
+};
+
+static inline uint32_t td_read32(const void *td, const uint64_t off)
+{
+	uint32_t val;
+	memcpy(&val, td + off, sizeof(uint32_t));
+	return val;
+}
+
+/* Advance (offset, size) from one td to the next */
+static inline int td_next(struct ane_nn *nn, uint64_t *offset, uint32_t *size)
+{
+	const struct anec *anec = to_anec(nn);
+	const void *td = nn->data + *offset;
+	const uint64_t next = td_read32(td, TD_HDR_NEXT);
+	const uint32_t next_size = td_next_size(td_read32(td, TD_HDR_NEXT_SIZE));
+
+	if (next < *offset + *size || next + next_size > anec->tsk_size ||
+	    next_size < TD_HDR_SIZE) {
+		ane_err("bad next td 0x%lx+0x%x after td at 0x%lx\n", next,
+			next_size, *offset);
+		return -EINVAL;
+	}
+
+	*offset = next;
+	*size = next_size;
+	return 0;
+}
+
+static inline void td_decode(const void *td, const uint32_t td_size,
+			     struct ane_task_prof *prof)
+{
+	uint64_t off = TD_HDR_SIZE;
+	uint32_t code;
+
+	memset(prof->streams, 0, sizeof(prof->streams));
+	memset(prof->regs, 0, sizeof(prof->regs));
+	prof->size = td_size;
+	prof->cycles = td_cycles(td_read32(td, TD_HDR_CYCLES));
+
+	while (off + sizeof(uint32_t) <= td_size) {
+		code = td_read32(td, off);
+		if (off + sizeof(uint32_t) * (stream_count(code) + 1) > td_size)
+			break;
+		for (int s = 0; s < ANE_STREAM_COUNT; s++) {
+			if (stream_addr(code) == td_streams[s].addr) {
+				prof->streams[s] = off;
+				prof->regs[s] = stream_count(code);
+				break;
+			}
+		}
+		off += sizeof(uint32_t) * (stream_count(code) + 1);
+	}
+}
+
+int ane_profile(struct ane_nn *nn, struct ane_task_prof *prof,
+		const uint32_t count)
+{
+	const struct anec *anec = to_anec(nn);
+	uint64_t start, offset = 0;
+	uint32_t tid, size = anec->td_size;
+	int err;
+
+	err = ane_wait(nn);
+	if (err < 0)
+		return err;
+
+	/*
+	 * Run one td at a time by bootstrapping from it. Later tds read what
+	 * earlier ones wrote to their channels; anything a td leaves only in
+	 * L2 for its successor is lost, so such networks may misbehave here.
+	 */
+	for (tid = 0; tid < anec->td_count && tid < count; tid++) {
+		if (tid) {
+			err = td_next(nn, &offset, &size);
+			if (err < 0)
+				break;
+		}
+
+		if (size > nn->btsp_chan.size) {
+			ane_err("td %u size 0x%x overflows bootstrap\n", tid,
+				size);
+			err = -E2BIG;
+			break;
+		}
+
+		memcpy(nn->btsp_chan.map, nn->data + offset, size);
+		set_nid(nn->btsp_chan.map, ANE_FIFO_NID);
+
+		start = ane_now_ns();
+		err = ane_submit(nn, 1, size, &prof[tid].exec_ns);
+		if (err < 0) {
+			ane_err("profiling td %u failed with %d\n", tid, err);
+			break;
+		}
+		/* older modules don't report device time; fall back to wall */
+		if (!prof[tid].exec_ns)
+			prof[tid].exec_ns = ane_now_ns() - start;
+
+		prof[tid].offset = offset;
+		td_decode(nn->data + offset, size, &prof[tid]);
+	}
+
+	memcpy(nn->btsp_chan.map, nn->data, anec->td_size);
+	set_nid(nn->btsp_chan.map, ANE_FIFO_NID);
+
+	return err < 0 ? err : (int)tid;
+}
+
+void ane_profile_print(struct ane_task_prof *prof, const uint32_t count)
+{
+	uint64_t total = 0;
+
+	for (uint32_t tid = 0; tid < count; tid++) {
+		total += prof[tid].exec_ns;
+	}
+
+	printf("%-5s %-8s %10s %6s %8s  streams (regs)\n", "td", "offset",
+	       "ns", "%", "cycles");
+	for (uint32_t tid = 0; tid < count; tid++) {
+		printf("%-5u 0x%-6lx %10lu %5.1f%% %8u ", tid, prof[tid].offset,
+		       prof[tid].exec_ns,
+		       total ? 100.0 * prof[tid].exec_ns / total : 0.0,
+		       prof[tid].cycles);
+		for (int s = 0; s < ANE_STREAM_COUNT; s++) {
+			if (prof[tid].regs[s])
+				printf(" %s(%u)", td_streams[s].name,
+				       prof[tid].regs[s]);
+		}
+		printf("\n");
+	}
+	printf("total %lu ns over %u tds\n", total, count);
 }
 
 #ifndef LIBANE_CONFIG_NO_INDEX_CHECK
@@ -491,20 +1031,62 @@ int ane_exec(struct ane_nn *nn)
 	} while (0)
 #endif /* LIBANE_CONFIG_NO_INDEX_CHECK */
 
+#define READY_CHECK(nn, ret)                                         \
+	({                                                           \
+		if (ane_wait(nn) < 0) {                              \
+			ane_err("model failed to load; bailing.\n"); \
+			return ret;                                  \
+		}                                                    \
+	})
+
 uint64_t __ane_src_size(struct ane_nn *nn, const uint32_t idx)
 {
+	READY_CHECK(nn, 0);
 	INDEX_CHECK(ane_src_count(nn), idx, 0);
 	return tile_size(nn, src_bdx(nn, idx));
 }
 
 uint64_t __ane_dst_size(struct ane_nn *nn, const uint32_t idx)
 {
+	READY_CHECK(nn, 0);
 	INDEX_CHECK(ane_dst_count(nn), idx, 0);
 	return tile_size(nn, dst_bdx(nn, idx));
 }
 
+#define plane_stride(nn, bdx) (to_anec(nn)->nchw[bdx][4])
+#define row_stride(nn, bdx)   (to_anec(nn)->nchw[bdx][5])
+
+uint64_t __ane_src_rstride(struct ane_nn *nn, const uint32_t idx)
+{
+	READY_CHECK(nn, 0);
+	INDEX_CHECK(ane_src_count(nn), idx, 0);
+	return row_stride(nn, src_bdx(nn, idx));
+}
+
+uint64_t __ane_src_pstride(struct ane_nn *nn, const uint32_t idx)
+{
+	READY_CHECK(nn, 0);
+	INDEX_CHECK(ane_src_count(nn), idx, 0);
+	return plane_stride(nn, src_bdx(nn, idx));
+}
+
+uint64_t __ane_dst_rstride(struct ane_nn *nn, const uint32_t idx)
+{
+	READY_CHECK(nn, 0);
+	INDEX_CHECK(ane_dst_count(nn), idx, 0);
+	return row_stride(nn, dst_bdx(nn, idx));
+}
+
+uint64_t __ane_dst_pstride(struct ane_nn *nn, const uint32_t idx)
+{
+	READY_CHECK(nn, 0);
+	INDEX_CHECK(ane_dst_count(nn), idx, 0);
+	return plane_stride(nn, dst_bdx(nn, idx));
+}
+
 void __ane_send(struct ane_nn *nn, void *from, const uint32_t idx)
 {
+	READY_CHECK(nn, );
 	INDEX_CHECK(ane_src_count(nn), idx, );
 	memcpy(nn->chans[src_bdx(nn, idx)].map, from,
 	       tile_size(nn, src_bdx(nn, idx)));
@@ -512,6 +1094,7 @@ void __ane_send(struct ane_nn *nn, void *from, const uint32_t idx)
 
 void __ane_read(struct ane_nn *nn, void *to, const uint32_t idx)
 {
+	READY_CHECK(nn, );
 	INDEX_CHECK(ane_dst_count(nn), idx, );
 	memcpy(to, nn->chans[dst_bdx(nn, idx)].map,
 	       tile_size(nn, dst_bdx(nn, idx)));
@@ -605,12 +1188,405 @@ static inline void ___ane_tile_read(struct ane_nn *nn, void *to,
 
 void __ane_tile_send(struct ane_nn *nn, void *from, const uint32_t idx)
 {
+	READY_CHECK(nn, );
 	INDEX_CHECK(ane_src_count(nn), idx, );
 	___ane_tile_send(nn, from, idx);
 }
 
 void __ane_tile_read(struct ane_nn *nn, void *to, const uint32_t idx)
 {
+	READY_CHECK(nn, );
 	INDEX_CHECK(ane_dst_count(nn), idx, );
 	___ane_tile_read(nn, to, idx);
 }
+
+/*
+ * Host tensor arena. One anonymous mapping, huge-page backed when possible,
+ * handed out with a bump pointer. Memory comes zeroed from the kernel and is
+ * only cleared again when needed: each allocation since the last reset is
+ * remembered by position, and a tensor buffer is re-zeroed only if it lands
+ * on previously used memory that didn't hold the same layout last time.
+ * Replaying the same sequence every request therefore never clears anything.
+ */
+
+#define HUGE_SYSFS	   "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size"
+#define HUGE_MEMINFO	   "/proc/meminfo"
+#define ARENA_RAW	   0 /* ane_arena_alloc(); no padding guarantee */
+#define ARENA_TAG_SRC	   0x1 /* low tag bits of ane_arena_src() buffers */
+#define ARENA_TAG_DST	   0x3 /* ... and of ane_arena_dst() buffers */
+
+#define align_up(x, a)	   ((((uint64_t)(x)) + (a) - 1) & -(uint64_t)(a))
+
+struct arena_rec {
+	uint64_t offset;
+	uint64_t size;
+	uint64_t tag; /* layout of the tensor, ARENA_RAW if unknown */
+};
+
+struct ane_arena {
+	void *map;
+	uint64_t size; /* usable size */
+	uint64_t used;
+	uint64_t dirty; /* high-water mark of memory ever handed out */
+	uint32_t count; /* allocations since the last reset */
+	uint32_t rec_count;
+	struct arena_rec *recs;
+};
+
+static inline uint64_t thp_size(void)
+{
+	unsigned long size = 0;
+	FILE *fp = fopen(HUGE_SYSFS, "r");
+	if (!fp)
+		return 0;
+	if (fscanf(fp, "%lu", &size) != 1)
+		size = 0;
+	fclose(fp);
+	return size;
+}
+
+static inline uint64_t hugetlb_size(void)
+{
+	char line[64];
+	unsigned long size = 0;
+	FILE *fp = fopen(HUGE_MEMINFO, "r");
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "Hugepagesize: %lu kB", &size) == 1)
+			break;
+	}
+	fclose(fp);
+	return size * 1024;
+}
+
+static inline int arena_map_hugetlb(struct ane_arena *arena,
+				    const uint64_t size)
+{
+	const uint64_t huge = hugetlb_size();
+	if (!huge)
+		return -ENOENT;
+
+	arena->size = align_up(size, huge);
+	arena->map = mmap(0, arena->size, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (arena->map == MAP_FAILED) {
+		arena->map = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static inline int arena_map_thp(struct ane_arena *arena, const uint64_t size)
+{
+	uint64_t huge = thp_size();
+	uint64_t len, head;
+	void *map;
+
+	if (!huge)
+		huge = TILE_SIZE;
+
+	/* over-allocate, then trim so the start is huge-page aligned */
+	arena->size = align_up(size, huge);
+	len = arena->size + huge;
+	map = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		   -1, 0);
+	if (map == MAP_FAILED)
+		return -ENOMEM;
+
+	head = align_up(map, huge) - (uint64_t)map;
+	if (head)
+		munmap(map, head);
+	if (len - head - arena->size)
+		munmap(map + head + arena->size, len - head - arena->size);
+
+	arena->map = map + head;
+	madvise(arena->map, arena->size, MADV_HUGEPAGE);
+
+	return 0;
+}
+
+struct ane_arena *ane_arena_init(const uint64_t size)
+{
+	struct ane_arena *arena = ane_zmalloc(sizeof(struct ane_arena));
+	if (!arena) {
+		return NULL;
+	}
+
+	/* no hugetlbfs pool; fall back to transparent huge pages */
+	if (arena_map_hugetlb(arena, size) < 0 &&
+	    arena_map_thp(arena, size) < 0) {
+		ane_err("failed to mmap arena size 0x%lx\n", size);
+		free(arena);
+		return NULL;
+	}
+
+	return arena;
+}
+
+void ane_arena_free(struct ane_arena *arena)
+{
+	if (munmap(arena->map, arena->size) < 0) {
+		ane_err("failed to munmap arena size 0x%lx\n", arena->size);
+	}
+	free(arena->recs);
+	free(arena);
+}
+
+void ane_arena_reset(struct ane_arena *arena)
+{
+	arena->used = 0;
+	arena->count = 0;
+}
+
+static void *arena_alloc(struct ane_arena *arena, const uint64_t size,
+			 const uint64_t tag)
+{
+	const uint64_t len = tile_align(size);
+	const uint64_t offset = arena->used;
+	struct arena_rec *rec, *recs;
+	int same;
+	void *ptr;
+
+	if (len > arena->size - arena->used) {
+		ane_err("arena exhausted; 0x%lx/0x%lx used, wanted 0x%lx\n",
+			arena->used, arena->size, size);
+		return NULL;
+	}
+
+	if (arena->count == arena->rec_count) {
+		recs = realloc(arena->recs, sizeof(struct arena_rec) *
+						    (arena->rec_count * 2 + 8));
+		if (!recs) {
+			ane_err("failed to grow arena records\n");
+			return NULL;
+		}
+		memset(recs + arena->rec_count, 0,
+		       sizeof(struct arena_rec) * (arena->rec_count + 8));
+		arena->recs = recs;
+		arena->rec_count = arena->rec_count * 2 + 8;
+	}
+
+	ptr = arena->map + offset;
+	rec = &arena->recs[arena->count];
+	same = (rec->offset == offset && rec->size == len && rec->tag == tag);
+
+	/* padding may hold someone else's data; clear what was ever used */
+	if (tag != ARENA_RAW && !same && offset < arena->dirty) {
+		memset(ptr, 0,
+		       (arena->dirty < offset + len ? arena->dirty : offset + len) -
+			       offset);
+	}
+
+	rec->offset = offset;
+	rec->size = len;
+	rec->tag = tag;
+	arena->count++;
+	arena->used += len;
+	if (arena->used > arena->dirty)
+		arena->dirty = arena->used;
+
+	return ptr;
+}
+
+void *ane_arena_alloc(struct ane_arena *arena, const uint64_t size)
+{
+	return arena_alloc(arena, size, ARENA_RAW);
+}
+
+/*
+ * FNV-1a over the tile geometry, low bits replaced by the direction so a
+ * src never reuses a dst slot as-is: ane_read() fills dst padding too.
+ * Never ARENA_RAW.
+ */
+static inline uint64_t arena_tag(struct ane_nn *nn, const int bdx,
+				 const uint64_t dir)
+{
+	uint64_t hash = 0xcbf29ce484222325UL;
+
+	for (int i = 0; i < 6; i++) {
+		hash ^= to_anec(nn)->nchw[bdx][i];
+		hash *= 0x100000001b3UL;
+	}
+
+	return (hash & ~0x3UL) | dir;
+}
+
+void *__ane_arena_src(struct ane_nn *nn, struct ane_arena *arena,
+		      const uint32_t idx)
+{
+	READY_CHECK(nn, NULL);
+	INDEX_CHECK(ane_src_count(nn), idx, NULL);
+	return arena_alloc(arena, tile_size(nn, src_bdx(nn, idx)),
+			   arena_tag(nn, src_bdx(nn, idx), ARENA_TAG_SRC));
+}
+
+void *__ane_arena_dst(struct ane_nn *nn, struct ane_arena *arena,
+		      const uint32_t idx)
+{
+	READY_CHECK(nn, NULL);
+	INDEX_CHECK(ane_dst_count(nn), idx, NULL);
+	return arena_alloc(arena, tile_size(nn, dst_bdx(nn, idx)),
+			   arena_tag(nn, dst_bdx(nn, idx), ARENA_TAG_DST));
+}
+
+/*
+ * Command-stream relayout. Rewrites the row/plane stride registers of the
+ * Src and Dst tile DMA streams so the engine walks a caller-chosen layout.
+ * A port belongs to the tile whose BAR slot its DMA config selects and must
+ * still hold the tile's current strides; every enabled port selecting the
+ * tile, in either direction, must be patchable or nothing is written.
+ */
+
+#define STRIDE_ALIGN	   0x40UL
+
+#define dma_cfg_en(cfg)	   ((cfg) & 0x1)
+#define dma_cfg_bar(cfg)   (((cfg) >> 8) & 0x1f)
+
+struct td_port {
+	enum ane_stream stream;
+	uint32_t cfg; /* DMA config register, relative to the stream base */
+	uint32_t row; /* row stride register */
+	uint32_t plane; /* plane stride register */
+};
+
+/* a tile can be written by one td and read back by the next: scan both */
+static const struct td_port td_ports[] = {
+	/* Src1DMAConfig, Src1RowStride, Src1PlaneStride */
+	{ ANE_STREAM_SRC, 0x00, 0x10, 0x14 },
+	/* Src2DMAConfig, Src2RowStride, Src2PlaneStride */
+	{ ANE_STREAM_SRC, 0x04, 0x20, 0x24 },
+	/* DstDMAConfig, DstRowStride, DstPlaneStride */
+	{ ANE_STREAM_DST, 0x00, 0x08, 0x0c },
+};
+
+static inline void td_write32(void *td, const uint64_t off, const uint32_t val)
+{
+	memcpy(td + off, &val, sizeof(uint32_t));
+}
+
+static int ane_relayout(struct ane_nn *nn, const int bdx, const uint64_t R,
+			const uint64_t P)
+{
+	const struct anec *anec = to_anec(nn);
+	const uint64_t N = anec->nchw[bdx][0];
+	const uint64_t C = anec->nchw[bdx][1];
+	const uint64_t H = anec->nchw[bdx][2];
+	const uint64_t W = anec->nchw[bdx][3];
+	const struct td_port *port;
+	struct ane_task_prof td;
+	uint64_t offset, base;
+	uint32_t size, cfg, row, plane;
+	void *ptr;
+	int patched = 0;
+	int err;
+
+	if ((R % STRIDE_ALIGN) || (P % STRIDE_ALIGN) || R > UINT32_MAX ||
+	    P > UINT32_MAX) {
+		ane_err("strides 0x%lx/0x%lx not 0x%lx aligned\n", R, P,
+			STRIDE_ALIGN);
+		return -EINVAL;
+	}
+
+	/* ane_tile()/ane_untile() walk planes of (P / R) rows */
+	if (R < W * sizeof(uint16_t) || P < R * H || P % R) {
+		ane_err("strides 0x%lx/0x%lx don't fit %lux%lu rows\n", R, P,
+			H, W);
+		return -EINVAL;
+	}
+
+	/* depth/group strides (C * P) aren't rewritten */
+	if (N > 1) {
+		ane_err("can't relayout batched tile %d (N = %lu)\n", bdx, N);
+		return -EINVAL;
+	}
+
+	if (N * C * P > tile_size(nn, bdx)) {
+		ane_err("layout needs 0x%lx but tile is 0x%lx\n", N * C * P,
+			tile_size(nn, bdx));
+		return -E2BIG;
+	}
+
+	/* check every port first so a refusal leaves the model intact */
+	for (int pass = 0; pass < 2; pass++) {
+		offset = 0;
+		size = anec->td_size;
+		for (uint32_t tid = 0; tid < anec->td_count; tid++) {
+			if (tid) {
+				err = td_next(nn, &offset, &size);
+				if (err < 0)
+					return err;
+			}
+
+			ptr = nn->data + offset;
+			td_decode(ptr, size, &td);
+			for (uint32_t i = 0;
+			     i < sizeof(td_ports) / sizeof(td_ports[0]); i++) {
+				port = &td_ports[i];
+				if ((port->cfg >> 2) >= td.regs[port->stream])
+					continue;
+				/* skip the code word */
+				base = td.streams[port->stream] +
+				       sizeof(uint32_t);
+				cfg = td_read32(ptr, base + port->cfg);
+				if (!dma_cfg_en(cfg) ||
+				    dma_cfg_bar(cfg) != (uint32_t)bdx)
+					continue;
+				if ((port->plane >> 2) >=
+				    td.regs[port->stream]) {
+					ane_err("td %u uses tile %d but lacks "
+						"its stride registers\n",
+						tid, bdx);
+					return -ENOENT;
+				}
+				/* a wrong register map refuses, not corrupts */
+				row = td_read32(ptr, base + port->row);
+				plane = td_read32(ptr, base + port->plane);
+				if (row != anec->nchw[bdx][5] ||
+				    plane != anec->nchw[bdx][4]) {
+					ane_err("td %u tile %d strides 0x%x/0x%x"
+						" don't match 0x%lx/0x%lx\n",
+						tid, bdx, row, plane,
+						anec->nchw[bdx][5],
+						anec->nchw[bdx][4]);
+					return -ENOENT;
+				}
+				if (pass) {
+					td_write32(ptr, base + port->row, R);
+					td_write32(ptr, base + port->plane, P);
+				}
+				patched++;
+			}
+		}
+
+		if (!patched) {
+			ane_err("no td references tile %d\n", bdx);
+			return -ENOENT;
+		}
+	}
+
+	/* keep tile/untile and the stride accessors in sync */
+	memcpy((void *)&anec->nchw[bdx][4], &P, sizeof(uint64_t));
+	memcpy((void *)&anec->nchw[bdx][5], &R, sizeof(uint64_t));
+
+	set_btsp_and_command(nn);
+
+	return 0;
+}
+
+int __ane_src_relayout(struct ane_nn *nn, const uint64_t R, const uint64_t P,
+		       const uint32_t idx)
+{
+	READY_CHECK(nn, -EINVAL);
+	INDEX_CHECK(ane_src_count(nn), idx, -EINVAL);
+	return ane_relayout(nn, src_bdx(nn, idx), R, P);
+}
+
+int __ane_dst_relayout(struct ane_nn *nn, const uint64_t R, const uint64_t P,
+		       const uint32_t idx)
+{
+	READY_CHECK(nn, -EINVAL);
+	INDEX_CHECK(ane_dst_count(nn), idx, -EINVAL);
+	return ane_relayout(nn, dst_bdx(nn, idx), R, P);
+}
@@ -39,9 +39,31 @@ extern "C" {
 		return 0;
 	}
 
+	Stage inputs in the device layout so sends are a straight copy:
+
+		struct ane_arena *arena = ane_arena_init(64 << 20); // once
+		void *x = ane_arena_src(nn, arena, 0); // tiled, padding zero
+		// write x at ane_src_rstride(nn, 0)/ane_src_pstride(nn, 0)
+		ane_send(nn, x, 0);
+		ane_arena_reset(arena); // recycle for the next request
+
+	Pay first-inference costs (page faults, cold TLB, power-up) at deploy:
+
+		struct ane_warmup stats;
+		ane_warmup(nn, 8, &stats); // 8 dummy executions
+		printf("cold %lu ns, warm %lu ns\n", stats.cold_ns, stats.warm_ns);
+
+	Many models can be loaded in parallel on a background worker pool:
+
+		struct ane_nn *a = ane_init_async("a.anec"); // returns at once
+		struct ane_nn *b = ane_init_async("b.anec");
+		if (ane_wait(a) < 0) { // optional; ane_exec() waits too
+			printf("failed to load model\n");
+		}
+
 	Compiles with gcc or g++:
 
-	gcc -I/usr/include/libane main.c /usr/lib/libane.a  # or -lane
+	gcc -I/usr/include/libane main.c /usr/lib/libane.a -pthread  # or -lane
 
 */
 
@@ -74,11 +96,13 @@ struct ane_nn {
 	struct anec anec; /* anec header loaded from path */
 	struct ane_bo chans[TILE_COUNT]; /* mmap-ed tile channels */
 	struct ane_bo btsp_chan; /* mmap-ed bootstrap channel */
+	struct ane_load *load; /* pending background load, if any */
 };
 
 /* #define LIBANE_CONFIG_NO_ERR */
 /* #define LIBANE_CONFIG_NO_INDEX_CHECK */
 /* #define LIBANE_CONFIG_NO_STATIC_ASSERT */
+/* #define LIBANE_CONFIG_LOAD_WORKERS 8 */
 
 #ifndef LIBANE_CONFIG_NO_STATIC_ASSERT
 #ifdef __cplusplus
@@ -97,11 +121,39 @@ struct ane_nn {
 struct ane_nn *__ane_init(const char *path, int dev_id);
 #define ane_init(path) (__ane_init(path, 0))
 
+/*
+ * Returns a handle immediately and loads the model on a background worker.
+ * ane_exec() and the send/read/size calls block until the load settles and
+ * fail if it did. Call ane_wait() before reading ane_src_count() or
+ * ane_dst_count() directly. A load still in flight when the process forks
+ * fails with -ECHILD in the child, and whatever it had set up is leaked
+ * there; ane_free() only releases the handle.
+ */
+struct ane_nn *__ane_init_async(const char *path, int dev_id);
+#define ane_init_async(path) (__ane_init_async(path, 0))
+int ane_wait(struct ane_nn *nn);
+
 void __ane_free(struct ane_nn *nn);
 #define ane_free(nn) (__ane_free(nn))
 
 int ane_exec(struct ane_nn *nn);
 
+struct ane_warmup {
+	uint64_t cold_ns; /* latency of the first execution */
+	uint64_t warm_ns; /* mean latency of the remaining executions */
+	uint32_t iters; /* executions issued */
+};
+
+/*
+ * Pre-faults every mapped channel and runs iters dummy executions back to
+ * back on whatever the input channels currently hold. Output channels are
+ * clobbered. stats may be NULL. The page faults stay paid, but the device
+ * autosuspends 1s after the last execution and drops its DART TLB, so the
+ * power/TLB part only holds if real traffic follows within that window.
+ */
+int ane_warmup(struct ane_nn *nn, const uint32_t iters,
+	       struct ane_warmup *stats);
+
 #define to_anec(nn)	  (&nn->anec)
 #define ane_src_count(nn) (to_anec(nn)->src_count)
 #define ane_dst_count(nn) (to_anec(nn)->dst_count)
@@ -117,6 +169,33 @@ uint64_t __ane_dst_size(struct ane_nn *nn, const uint32_t idx);
 #define ane_src_size(nn, idx) _LIBANE_SF(__ane_src_size, nn, idx)
 #define ane_dst_size(nn, idx) _LIBANE_SF(__ane_dst_size, nn, idx)
 
+/* Tiled layout: element (n, c, h, w) lives at (n * C + c) * P + h * R + w * 2 */
+uint64_t __ane_src_rstride(struct ane_nn *nn, const uint32_t idx);
+uint64_t __ane_src_pstride(struct ane_nn *nn, const uint32_t idx);
+uint64_t __ane_dst_rstride(struct ane_nn *nn, const uint32_t idx);
+uint64_t __ane_dst_pstride(struct ane_nn *nn, const uint32_t idx);
+#define ane_src_rstride(nn, idx) _LIBANE_SF(__ane_src_rstride, nn, idx)
+#define ane_src_pstride(nn, idx) _LIBANE_SF(__ane_src_pstride, nn, idx)
+#define ane_dst_rstride(nn, idx) _LIBANE_SF(__ane_dst_rstride, nn, idx)
+#define ane_dst_pstride(nn, idx) _LIBANE_SF(__ane_dst_pstride, nn, idx)
+
+/*
+ * Rewrites the model's stride registers so the engine reads/writes the
+ * tensor with row stride R and plane stride P (both 0x40 aligned, P a
+ * multiple of R, fitting the tile, N == 1). Every td reading or writing the
+ * tensor is patched, so a dst fed back into a later layer stays consistent.
+ * Returns < 0 and leaves the model untouched if any of them can't be. With
+ * R == W * 2 and P == R * H, tiling becomes a plain copy.
+ */
+int __ane_src_relayout(struct ane_nn *nn, const uint64_t R, const uint64_t P,
+		       const uint32_t idx);
+int __ane_dst_relayout(struct ane_nn *nn, const uint64_t R, const uint64_t P,
+		       const uint32_t idx);
+#define ane_src_relayout(nn, R, P, idx) \
+	_LIBANE_SF(__ane_src_relayout, nn, idx, R, P)
+#define ane_dst_relayout(nn, R, P, idx) \
+	_LIBANE_SF(__ane_dst_relayout, nn, idx, R, P)
+
 void __ane_send(struct ane_nn *nn, void *from, const uint32_t idx);
 void __ane_read(struct ane_nn *nn, void *to, const uint32_t idx);
 #define ane_send(nn, from, idx) _LIBANE_SF(__ane_send, nn, idx, from)
@@ -134,6 +213,58 @@ void ane_untile(void *data, void *tile, const uint64_t N, const uint64_t C,
 		const uint64_t H, const uint64_t W, const uint64_t P,
 		const uint64_t R);
 
+enum ane_stream {
+	ANE_STREAM_KERNEL,
+	ANE_STREAM_COMMON,
+	ANE_STREAM_SRC,
+	ANE_STREAM_L2,
+	ANE_STREAM_PLANAR,
+	ANE_STREAM_NEURAL,
+	ANE_STREAM_DST,
+	ANE_STREAM_COUNT,
+};
+
+struct ane_task_prof {
+	uint64_t offset; /* td offset in the command buffer */
+	uint64_t exec_ns; /* device time of the td run alone */
+	uint32_t size; /* td size in bytes */
+	uint32_t cycles; /* compiler cycle estimate from the td header */
+	uint32_t streams[ANE_STREAM_COUNT]; /* register stream offset in td */
+	uint32_t regs[ANE_STREAM_COUNT]; /* register count, 0 if absent */
+};
+
+/*
+ * Runs the network one task descriptor at a time, filling prof for up to
+ * count tds. Returns the number of tds profiled. Slower than ane_exec();
+ * for diagnosis only.
+ */
+int ane_profile(struct ane_nn *nn, struct ane_task_prof *prof,
+		const uint32_t count);
+void ane_profile_print(struct ane_task_prof *prof, const uint32_t count);
+
+/*
+ * Host tensor arena. ane_arena_src()/ane_arena_dst() hand out buffers
+ * already in the model's tiled layout (see ane_src_rstride()) with zeroed
+ * padding, sized for a straight ane_send()/ane_read(). ane_arena_reset()
+ * recycles them for the next request; a buffer is re-zeroed only if it
+ * lands where a different layout, a dst buffer or an ane_arena_alloc()
+ * buffer was handed out before, so replaying the same sequence costs no
+ * clearing.
+ * ane_arena_alloc() memory carries no padding guarantee.
+ */
+struct ane_arena;
+struct ane_arena *ane_arena_init(const uint64_t size);
+void ane_arena_free(struct ane_arena *arena);
+void ane_arena_reset(struct ane_arena *arena);
+void *ane_arena_alloc(struct ane_arena *arena, const uint64_t size);
+
+void *__ane_arena_src(struct ane_nn *nn, struct ane_arena *arena,
+		      const uint32_t idx);
+void *__ane_arena_dst(struct ane_nn *nn, struct ane_arena *arena,
+		      const uint32_t idx);
+#define ane_arena_src(nn, arena, idx) _LIBANE_SF(__ane_arena_src, nn, idx, arena)
+#define ane_arena_dst(nn, arena, idx) _LIBANE_SF(__ane_arena_dst, nn, idx, arena)
+
 #if defined(__cplusplus)
 }
 #endif
@@ -0,0 +1,447 @@
+// SPDX-License-Identifier: MIT
+/* Copyright 2022 Eileen Yoon <eyn@gmx.com> */
+
+/*
+ * ane-stress: multi-process contention stress test.
+ *
+ * Forks N clients, each looping load -> exec x E -> free on one of the given
+ * models (assigned round-robin) until the deadline, then reports per-client
+ * throughput and latency percentiles, the Jain fairness index and driver
+ * lock contention.
+ *
+ * Models are either anec paths or "sim:<exec_us>[:<load_us>]", a simulated
+ * device whose engine/iommu locks are process-shared mutexes, so the tool
+ * runs without hardware and mixes with real models.
+ *
+ *	./ane-stress -n 16 -t 10 -e 32 small.anec large.anec
+ *	./ane-stress -n 32 sim:200 sim:5000:20000
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ane.h"
+#include "ane_utils.h"
+
+#define MAX_CLIENTS   256
+#define MAX_MODELS    32
+#define MAX_SAMPLES   (1 << 16)
+#define SIM_PREFIX    "sim:"
+#define SYSFS_LOCKS   "/sys/class/accel/accel%d/device/%s"
+#define MAX_NODE_LEN  64
+#define MAX_ACCEL     64
+
+struct sim_lock {
+	pthread_mutex_t lock;
+	uint64_t contended;
+	uint64_t wait_ns;
+};
+
+struct client_stat {
+	int model;
+	int err;
+	uint64_t loads;
+	uint64_t execs;
+	uint64_t elapsed_ns;
+	uint64_t nsamples;
+	uint64_t samples[MAX_SAMPLES]; /* exec latencies in ns */
+};
+
+struct shared {
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint64_t stop_ns; /* set if the run was cut short */
+	struct sim_lock engine;
+	struct sim_lock iommu;
+	struct client_stat clients[];
+};
+
+struct model {
+	const char *path;
+	int sim;
+	uint64_t exec_us;
+	uint64_t load_us;
+};
+
+struct lock_stat {
+	uint64_t contended;
+	uint64_t wait_ns;
+};
+
+static struct model models[MAX_MODELS];
+static int model_count;
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static inline void sleep_until(uint64_t ns)
+{
+	struct timespec ts = { .tv_sec = ns / 1000000000UL,
+			       .tv_nsec = ns % 1000000000UL };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+		;
+}
+
+static inline void sleep_us(uint64_t us)
+{
+	sleep_until(now_ns() + us * 1000UL);
+}
+
+static void sim_lock_init(struct sim_lock *sl)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutex_init(&sl->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+/* Same accounting as the driver's ane_mutex_lock() */
+static void sim_lock_hold(struct sim_lock *sl, uint64_t us)
+{
+	uint64_t start;
+
+	if (pthread_mutex_trylock(&sl->lock)) {
+		start = now_ns();
+		pthread_mutex_lock(&sl->lock);
+		__atomic_add_fetch(&sl->contended, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&sl->wait_ns, now_ns() - start,
+				   __ATOMIC_RELAXED);
+	}
+
+	sleep_us(us);
+	pthread_mutex_unlock(&sl->lock);
+}
+
+static int parse_model(struct model *m, const char *arg)
+{
+	char *end;
+
+	m->path = arg;
+	if (strncmp(arg, SIM_PREFIX, strlen(SIM_PREFIX)))
+		return 0;
+
+	m->sim = 1;
+	m->exec_us = strtoull(arg + strlen(SIM_PREFIX), &end, 0);
+	m->load_us = (*end == ':') ? strtoull(end + 1, &end, 0) : 0;
+	if (*end != '\0' || !m->exec_us) {
+		ane_err("bad simulated model %s\n", arg);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static inline int running(struct shared *sh)
+{
+	return !__atomic_load_n(&sh->stop_ns, __ATOMIC_RELAXED) &&
+	       now_ns() < sh->end_ns;
+}
+
+static void record(struct client_stat *cs, uint64_t lat)
+{
+	if (cs->nsamples < MAX_SAMPLES)
+		cs->samples[cs->nsamples++] = lat;
+	cs->execs++;
+}
+
+static int client_run(struct shared *sh, int cid, int dev_id, uint64_t rate,
+		      uint64_t execs_per_load)
+{
+	struct client_stat *cs = &sh->clients[cid];
+	const struct model *m = &models[cs->model];
+	const uint64_t period = rate ? 1000000000UL / rate : 0;
+	uint64_t next, start;
+	struct ane_nn *nn = NULL;
+
+	sleep_until(sh->start_ns);
+	next = sh->start_ns;
+
+	while (running(sh)) {
+		if (m->sim) {
+			sim_lock_hold(&sh->iommu, m->load_us);
+		} else {
+			nn = __ane_init(m->path, dev_id);
+			if (!nn) {
+				cs->err = -ENODEV;
+				return cs->err;
+			}
+		}
+		cs->loads++;
+
+		for (uint64_t i = 0; i < execs_per_load; i++) {
+			if (!running(sh))
+				break;
+			if (period) {
+				next += period;
+				sleep_until(next);
+			}
+
+			start = now_ns();
+			if (m->sim) {
+				sim_lock_hold(&sh->engine, m->exec_us);
+			} else if (ane_exec(nn) < 0) {
+				cs->err = -EIO;
+				ane_free(nn);
+				return cs->err;
+			}
+			record(cs, now_ns() - start);
+		}
+
+		if (m->sim)
+			sim_lock_hold(&sh->iommu, m->load_us / 4);
+		else
+			ane_free(nn);
+	}
+
+	cs->elapsed_ns = now_ns() - sh->start_ns;
+	return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static inline double percentile_us(const uint64_t *sorted, uint64_t n,
+				   double p)
+{
+	if (!n)
+		return 0.0;
+	return sorted[(uint64_t)((n - 1) * p)] / 1000.0;
+}
+
+/* (sum x)^2 / (n * sum x^2); 1.0 is perfectly fair, 1/n is one winner */
+static double jain_index(const double *x, int n)
+{
+	double sum = 0.0, sq = 0.0;
+
+	for (int i = 0; i < n; i++) {
+		sum += x[i];
+		sq += x[i] * x[i];
+	}
+
+	return sq ? (sum * sum) / (n * sq) : 0.0;
+}
+
+/*
+ * Find the accel node of the dev_id-th ANE, counting the same way libane's
+ * device_open() does, and read "<contended> <wait_ns>" from its attribute.
+ */
+static int read_lock_stat(int dev_id, const char *name, struct lock_stat *ls)
+{
+	char node[MAX_NODE_LEN];
+	unsigned long long contended, wait_ns;
+	int found = 0;
+	FILE *fp;
+
+	memset(ls, 0, sizeof(*ls));
+	for (int i = 0; i < MAX_ACCEL; i++) {
+		snprintf(node, MAX_NODE_LEN, SYSFS_LOCKS, i, name);
+		fp = fopen(node, "r");
+		if (!fp)
+			continue;
+		if (found++ != dev_id) {
+			fclose(fp);
+			continue;
+		}
+		if (fscanf(fp, "%llu %llu", &contended, &wait_ns) != 2) {
+			fclose(fp);
+			return -EINVAL;
+		}
+		ls->contended = contended;
+		ls->wait_ns = wait_ns;
+		fclose(fp);
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+static void report_lock(const char *name, int have, const struct lock_stat *a,
+			const struct lock_stat *b, const struct sim_lock *sim)
+{
+	if (have)
+		ane_log("%-11s driver: contended %llu, waited %.3f ms\n", name,
+			(unsigned long long)(b->contended - a->contended),
+			(b->wait_ns - a->wait_ns) / 1e6);
+	if (sim->contended)
+		ane_log("%-11s sim:    contended %llu, waited %.3f ms\n", name,
+			(unsigned long long)sim->contended, sim->wait_ns / 1e6);
+}
+
+static void report(struct shared *sh, int clients)
+{
+	double tput[MAX_CLIENTS];
+	double model_tput[MAX_CLIENTS];
+	struct client_stat *cs;
+	uint64_t end = sh->stop_ns ? sh->stop_ns : sh->end_ns;
+	uint64_t total = 0;
+	int n;
+
+	ane_log("%-4s %-24s %8s %10s %10s %9s %9s %9s %9s\n", "cid", "model",
+		"loads", "execs", "exec/s", "p50(us)", "p95(us)", "p99(us)",
+		"max(us)");
+
+	for (int cid = 0; cid < clients; cid++) {
+		cs = &sh->clients[cid];
+		qsort(cs->samples, cs->nsamples, sizeof(uint64_t), cmp_u64);
+		tput[cid] = cs->elapsed_ns ? cs->execs * 1e9 / cs->elapsed_ns :
+					     0.0;
+		total += cs->execs;
+
+		ane_log("%-4d %-24s %8llu %10llu %10.1f %9.1f %9.1f %9.1f %9.1f%s\n",
+			cid, models[cs->model].path,
+			(unsigned long long)cs->loads,
+			(unsigned long long)cs->execs, tput[cid],
+			percentile_us(cs->samples, cs->nsamples, 0.50),
+			percentile_us(cs->samples, cs->nsamples, 0.95),
+			percentile_us(cs->samples, cs->nsamples, 0.99),
+			percentile_us(cs->samples, cs->nsamples, 1.00),
+			cs->err ? " (failed)" : "");
+	}
+
+	ane_log("total execs %llu over %.2f s\n", (unsigned long long)total,
+		end > sh->start_ns ? (end - sh->start_ns) / 1e9 : 0.0);
+	ane_log("jain fairness (all clients): %.4f\n", jain_index(tput, clients));
+
+	/* clients sharing a model should see the same share */
+	for (int mid = 0; mid < model_count; mid++) {
+		n = 0;
+		for (int cid = 0; cid < clients; cid++) {
+			if (sh->clients[cid].model == mid)
+				model_tput[n++] = tput[cid];
+		}
+		if (n > 1)
+			ane_log("jain fairness (%s): %.4f\n", models[mid].path,
+				jain_index(model_tput, n));
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n clients] [-t seconds] [-r execs/s per client]\n"
+		"          [-e execs per load] [-d dev_id] model... \n"
+		"model is an anec path or sim:<exec_us>[:<load_us>]\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	int clients = 8, dev_id = 0, seconds = 10, opt, err = 0;
+	uint64_t rate = 0, execs_per_load = 16;
+	struct lock_stat engine0 = {}, engine1 = {}, iommu0 = {}, iommu1 = {};
+	int have_engine, have_iommu;
+	struct shared *sh;
+	size_t size;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "n:t:r:e:d:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			clients = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			rate = strtoull(optarg, NULL, 0);
+			break;
+		case 'e':
+			execs_per_load = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			dev_id = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (optind >= argc || clients <= 0 || clients > MAX_CLIENTS ||
+	    seconds <= 0 || !execs_per_load) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (model_count == MAX_MODELS) {
+			ane_err("at most %d models\n", MAX_MODELS);
+			return -1;
+		}
+		if (parse_model(&models[model_count++], argv[i]) < 0)
+			return -1;
+	}
+
+	size = sizeof(struct shared) + clients * sizeof(struct client_stat);
+	sh = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		  -1, 0);
+	if (sh == MAP_FAILED) {
+		ane_err("failed to mmap shared stats size 0x%zx\n", size);
+		return -1;
+	}
+
+	sim_lock_init(&sh->engine);
+	sim_lock_init(&sh->iommu);
+	for (int cid = 0; cid < clients; cid++) {
+		sh->clients[cid].model = cid % model_count;
+	}
+
+	have_engine = !read_lock_stat(dev_id, "engine_lock", &engine0);
+	have_iommu = !read_lock_stat(dev_id, "iommu_lock", &iommu0);
+
+	/* leave the children time to fork before the clock starts */
+	sh->start_ns = now_ns() + 200000000UL;
+	sh->end_ns = sh->start_ns + seconds * 1000000000UL;
+
+	for (int cid = 0; cid < clients; cid++) {
+		pid = fork();
+		if (pid < 0) {
+			ane_err("failed to fork client %d\n", cid);
+			/* stop whoever already started */
+			__atomic_store_n(&sh->stop_ns, now_ns(), __ATOMIC_RELAXED);
+			clients = cid;
+			err = -1;
+			break;
+		}
+		if (!pid)
+			_exit(client_run(sh, cid, dev_id, rate, execs_per_load) ?
+				      1 :
+				      0);
+	}
+
+	for (int cid = 0; cid < clients; cid++) {
+		wait(NULL);
+	}
+
+	have_engine = have_engine &&
+		      !read_lock_stat(dev_id, "engine_lock", &engine1);
+	have_iommu = have_iommu &&
+		     !read_lock_stat(dev_id, "iommu_lock", &iommu1);
+
+	report(sh, clients);
+	report_lock("engine_lock", have_engine, &engine0, &engine1, &sh->engine);
+	report_lock("iommu_lock", have_iommu, &iommu0, &iommu1, &sh->iommu);
+	if (!have_engine && !have_iommu)
+		ane_log("driver lock stats unavailable\n");
+
+	for (int cid = 0; cid < clients; cid++) {
+		if (sh->clients[cid].err)
+			err = -1;
+	}
+
+	munmap(sh, size);
+	return err;
+}